@@ -0,0 +1,60 @@
+#pragma once
+
+#include <stdint.h>
+
+// Longest interval (ms) accepted as a single beat, i.e. 30bpm
+#define BEAT_RR_MAX 2000
+
+/**
+ * Summary of the beat intervals (RR) currently in the window
+ *
+ * All intervals are in ms.
+ */
+typedef struct {
+  /**
+   * Number of intervals in the window
+   */
+  uint8_t n;
+  /**
+   * Most recent interval
+   */
+  uint16_t last;
+  uint16_t mean;
+  /**
+   * Standard deviation (SDNN)
+   */
+  uint16_t sd;
+  uint16_t min;
+  uint16_t max;
+  /**
+   * Root mean square of successive differences
+   */
+  uint16_t rmssd;
+} beat_stats_t;
+
+/**
+ * Discard all intervals, e.g. after the finger has been lifted
+ */
+void beat_reset();
+
+/**
+ * Push one beat interval into the window, evicting the oldest once full
+ */
+void beat_add(uint16_t rr);
+
+/**
+ * Average heart rate over the window, 0 if no intervals are available
+ */
+uint16_t beat_mean_bpm();
+
+/**
+ * Mean interval over the window, 0 if no intervals are available
+ */
+uint16_t beat_mean_rr();
+
+void beat_get_stats(beat_stats_t * stats);
+
+/**
+ * Print the current stats as one telemetry line
+ */
+void beat_print_stats();
@@ -10,13 +10,19 @@
 void process_init_hb();
 
 /**
- * Process one photodiode reading
+ * Process a batch of photodiode readings, oldest first
+ *
+ * Beat detection runs over every sample; the LCD and serial are updated
+ * once afterwards from the final state.
  */
-void process_raw_reading(adc_sample_t *);
+void process_hr_batch(const adc_sample_t * samples, uint8_t n);
 
 /**
  * Init internal parameters for glucose reading after mode switch
  */
 void process_init_glucose();
 
-void process_glucose_reading(adc_sample_t * sample);
+/**
+ * Process a batch of photoresistor readings, displaying their average
+ */
+void process_glucose_batch(const adc_sample_t * samples, uint8_t n);
@@ -0,0 +1,47 @@
+#pragma once
+
+#include <stdint.h>
+
+// Signal-quality flags
+// Last sample at or near 0, e.g. finger just placed over photodiode
+#define SQI_DARK    (1<<0)
+// Last sample at or near ADC full scale
+#define SQI_CLIPPED (1<<1)
+
+// Quality index at or above which the signal is considered good enough to lock onto quickly.
+// Perfusion alone reaches this at a perfusion index of ~85/1000
+#define SQI_GOOD 50
+// Quality index below which the signal probably doesn't contain a pulse (perfusion index ~25/1000)
+#define SQI_POOR 15
+
+/**
+ * Reset the signal-quality estimator, e.g. on mode or channel change
+ */
+void sqi_reset();
+
+/**
+ * Update the estimator with one photodiode sample
+ */
+void sqi_update(uint16_t val);
+
+/**
+ * Update beat-to-beat consistency with a newly detected interval and the current mean interval (ms)
+ */
+void sqi_beat(uint16_t rr, uint16_t mean_rr);
+
+/**
+ * Flags (SQI_*) describing the last sample
+ */
+uint8_t sqi_flags();
+
+/**
+ * Perfusion index: pulsatile (AC, mean absolute deviation) over steady (DC) component, in 1/1000
+ *
+ * 0 while the DC level is too low for the ratio to be meaningful.
+ */
+uint16_t sqi_perfusion();
+
+/**
+ * Combined quality index, 0 (unusable) to 100
+ */
+uint8_t sqi_quality();
@@ -0,0 +1,123 @@
+#include "beat.h"
+
+#include <Arduino.h>
+
+// Number of intervals kept; sums below stay within 32 bits for intervals up to BEAT_RR_MAX
+#define BEAT_WINDOW 16
+
+static uint16_t rr_ring[BEAT_WINDOW];
+static uint8_t rr_head = 0; // index of the oldest interval
+static uint8_t rr_count = 0;
+
+// Running sums over the window
+static uint32_t rr_sum = 0, rr_sum_sq = 0, rr_sum_diff_sq = 0;
+
+// Monotonic queues of ring indices for sliding min/max: values are increasing in
+// `min_q` and decreasing in `max_q`, so the front always holds the extreme
+static uint8_t min_q[BEAT_WINDOW], max_q[BEAT_WINDOW];
+static uint8_t min_q_head, min_q_len, max_q_head, max_q_len;
+
+static inline uint8_t ring_idx(uint8_t i) {
+  return i >= BEAT_WINDOW ? i - BEAT_WINDOW : i;
+}
+
+static inline uint32_t sq_diff(uint16_t a, uint16_t b) {
+  const uint16_t d = a > b ? a - b : b - a;
+  return (uint32_t) d * d;
+}
+
+/**
+ * Integer square root, rounded down
+ */
+static uint16_t isqrt32(uint32_t v) {
+  uint32_t res = 0, bit = 1UL << 30;
+  while (bit > v) bit >>= 2;
+  while (bit) {
+    if (v >= res + bit) {
+      v -= res + bit;
+      res = (res >> 1) + bit;
+    } else {
+      res >>= 1;
+    }
+    bit >>= 2;
+  }
+  return res;
+}
+
+void beat_reset() {
+  rr_head = rr_count = 0;
+  rr_sum = rr_sum_sq = rr_sum_diff_sq = 0;
+  min_q_head = min_q_len = max_q_head = max_q_len = 0;
+}
+
+void beat_add(uint16_t rr) {
+  if (rr > BEAT_RR_MAX) return; // missed beats rather than one interval
+
+  if (rr_count == BEAT_WINDOW) { // evict oldest
+    const uint16_t old = rr_ring[rr_head];
+    rr_sum -= old;
+    rr_sum_sq -= (uint32_t) old * old;
+    rr_sum_diff_sq -= sq_diff(rr_ring[ring_idx(rr_head + 1)], old);
+    if (min_q_len && min_q[min_q_head] == rr_head) {
+      min_q_head = ring_idx(min_q_head + 1);
+      --min_q_len;
+    }
+    if (max_q_len && max_q[max_q_head] == rr_head) {
+      max_q_head = ring_idx(max_q_head + 1);
+      --max_q_len;
+    }
+    rr_head = ring_idx(rr_head + 1);
+    --rr_count;
+  }
+
+  const uint8_t pos = ring_idx(rr_head + rr_count);
+  if (rr_count) rr_sum_diff_sq += sq_diff(rr, rr_ring[ring_idx(pos + BEAT_WINDOW - 1)]);
+  rr_ring[pos] = rr;
+  ++rr_count;
+  rr_sum += rr;
+  rr_sum_sq += (uint32_t) rr * rr;
+
+  // drop entries from the back that can never be the extreme again
+  while (min_q_len && rr_ring[min_q[ring_idx(min_q_head + min_q_len - 1)]] >= rr) --min_q_len;
+  min_q[ring_idx(min_q_head + min_q_len)] = pos;
+  ++min_q_len;
+  while (max_q_len && rr_ring[max_q[ring_idx(max_q_head + max_q_len - 1)]] <= rr) --max_q_len;
+  max_q[ring_idx(max_q_head + max_q_len)] = pos;
+  ++max_q_len;
+}
+
+uint16_t beat_mean_bpm() {
+  if (!rr_count) return 0;
+  return 60000UL * rr_count / rr_sum;
+}
+
+uint16_t beat_mean_rr() {
+  if (!rr_count) return 0;
+  return rr_sum / rr_count;
+}
+
+void beat_get_stats(beat_stats_t * stats) {
+  stats->n = rr_count;
+  if (!rr_count) {
+    stats->last = stats->mean = stats->sd = stats->min = stats->max = stats->rmssd = 0;
+    return;
+  }
+  stats->last = rr_ring[ring_idx(rr_head + rr_count - 1)];
+  stats->mean = rr_sum / rr_count;
+  // n*sum(x^2) - sum(x)^2 = n^2 * var, both terms fit in 32 bits for the window and interval limits
+  stats->sd = isqrt32((rr_count * rr_sum_sq - rr_sum * rr_sum) / ((uint16_t) rr_count * rr_count));
+  stats->min = rr_ring[min_q[min_q_head]];
+  stats->max = rr_ring[max_q[max_q_head]];
+  stats->rmssd = rr_count > 1 ? isqrt32(rr_sum_diff_sq / (rr_count - 1)) : 0;
+}
+
+void beat_print_stats() {
+  beat_stats_t stats;
+  beat_get_stats(&stats);
+  Serial.print(F("hrv, rr: ")); Serial.print(stats.last);
+  Serial.print(F(" mean: ")); Serial.print(stats.mean);
+  Serial.print(F(" sd: ")); Serial.print(stats.sd);
+  Serial.print(F(" min: ")); Serial.print(stats.min);
+  Serial.print(F(" max: ")); Serial.print(stats.max);
+  Serial.print(F(" rmssd: ")); Serial.println(stats.rmssd);
+}
@@ -6,13 +6,58 @@
 #include "lcd.h"
 
 #include "process.h"
+#include "sqi.h"
 
 // ADC configuration
 #define READ_BUF_SZ 72
-// Number of ADC conversions to average (oversample) for one sample
-// One ADC conversion takes 13 ADC clk cycles, i.e. conversion rate of ~9.6kHz with 125kHz ADC clk
-// Oversampling of 256 results in sample rate of ~38Hz
-#define READ_OVERSAMPLE 256
+// Auto mode: time (in ms) the photodiode must read dark, or show a good pulsatile signal, before switching to heartbeat
+#define AUTO_DWELL_DARK 1000
+#define AUTO_DWELL_PULSE 300
+
+// Set to 1 to print per-batch processing latency over serial
+#define ACQ_BENCH 0
+
+/**
+ * ADC acquisition parameters applied when entering a measurement mode
+ */
+typedef struct {
+  /**
+   * log2 of the number of ADC conversions averaged into one sample
+   */
+  uint8_t oversample_shift;
+  /**
+   * Analog channel sampled when the mode is entered
+   */
+  uint8_t channel;
+  /**
+   * Minimum number of buffered samples before a batch is processed
+   */
+  uint8_t batch_sz;
+  /**
+   * Minimum time between processing passes, in ms
+   */
+  uint16_t proc_interval;
+} acq_profile_t;
+
+/**
+ * Acquisition profile for each mode, indexed by `measurement_mode_t`
+ *
+ * One ADC conversion takes 13 ADC clk cycles, i.e. conversion rate of ~9.6kHz with 125kHz ADC clk,
+ * so the oversample factor (a power of 2) sets the sample rate:
+ * 64 -> ~150Hz, 128 -> ~75Hz, 1024 -> ~9.4Hz
+ *
+ * Per-mode latency has NOT been measured on hardware yet (enable ACQ_BENCH to do so).
+ * Expected age of the oldest sample in a batch from sample periods alone, before processing
+ * time: auto ~7ms, heartbeat ~40-55ms (4 x 13ms), glucose ~110-220ms (2 x 107ms, 200ms interval).
+ */
+static const acq_profile_t acq_profiles[MODE_LAST + 1] = {
+  // Auto: fast, unbatched samples for quickest presence detection
+  { 6, PDIODE_A_CH, 1, 0 },
+  // Heartbeat: higher sample rate for sharper peaks, processed in small batches
+  { 7, PDIODE_A_CH, 4, 0 },
+  // Glucose: heavy averaging, slow readout
+  { 10, PRESIST_A_CH, 2, 200 },
+};
 
 void setup() {
   // Configure ADC peripheral
@@ -47,6 +92,8 @@ volatile adc_sample_t results[READ_BUF_SZ];
 volatile uint8_t results_available = 0;
 volatile uint16_t num_readings = 0;
 volatile uint8_t sample_channel = PDIODE_A_CH;
+volatile uint8_t oversample_shift = acq_profiles[MODE_AUTO].oversample_shift;
+volatile uint16_t oversample_n = (uint16_t) 1 << acq_profiles[MODE_AUTO].oversample_shift;
 
 /**
  * ADC sample complete ISR
@@ -59,9 +106,9 @@ ISR(ADC_vect) { // a conversion has just completed
   } else {
     sum += ADC; // `ADC` register contains conversion result, read and add to sum
     ++num_readings;
-    if (num_readings > READ_OVERSAMPLE) { // acquired sufficient samples
+    if (num_readings >= oversample_n) { // acquired sufficient samples
       if (results_available < READ_BUF_SZ) { // have space in output buffer
-        results[results_available].val = sum/READ_OVERSAMPLE;
+        results[results_available].val = sum >> oversample_shift;
         results[results_available].t = millis();
         ++results_available;
       }
@@ -91,6 +138,27 @@ static void adc_update_ch(uint8_t new_ch) {
   SREG = sreg;
 }
 
+static uint8_t proc_batch_sz = acq_profiles[MODE_AUTO].batch_sz;
+static uint16_t proc_interval = acq_profiles[MODE_AUTO].proc_interval;
+
+/**
+ * Apply an acquisition profile
+ *
+ * Oversample factor and channel are swapped together with interrupts disabled,
+ * so the ISR never produces a sample mixing conversions from two profiles.
+ */
+static void adc_apply_profile(const acq_profile_t * profile) {
+  uint8_t sreg = SREG;
+  cli();
+  sample_channel = profile->channel;
+  oversample_shift = profile->oversample_shift;
+  oversample_n = (uint16_t) 1 << profile->oversample_shift;
+  results_available = num_readings = sum = 0; // discard samples taken with the previous profile
+  SREG = sreg;
+  proc_batch_sz = profile->batch_sz;
+  proc_interval = profile->proc_interval;
+}
+
 
 static measurement_mode_t cur_mode = MODE_AUTO;
 static uint32_t last_mode_change = 0;
@@ -100,18 +168,19 @@ void change_mode(measurement_mode_t mode, uint8_t inactivity) {
   switch (mode) {
     case MODE_AUTO:
       title = inactivity ? "Return to auto" : "Automatic";
+      sqi_reset();
       break;
     case MODE_HEARTBEAT:
       title = "Heartbeat";
       process_init_hb();
-      adc_update_ch(PDIODE_A_CH); // ensure correct ADC channel set (noop if already correct)
       break;
     case MODE_GLUCOSE:
       title = "Glucose";
       process_init_glucose();
-      adc_update_ch(PRESIST_A_CH);
       break;
   }
+  adc_apply_profile(&acq_profiles[mode]);
+  Serial.print(F("mode: ")); Serial.println(mode);
   lcd_draw_alert(inactivity ? "User Inactivity" : "Current Mode", title);
   last_mode_change = millis();
   cur_mode = mode;
@@ -194,6 +263,7 @@ void loop() {
   static uint32_t last_anim = 0;
   static uint8_t last_pd_in_thres = 0;
   static uint32_t first_pd_in_thres_time = 0;
+  static uint32_t last_proc = 0;
 
   const uint32_t now = millis();
 
@@ -207,7 +277,9 @@ void loop() {
     render_initial_mode(cur_mode);
   }
 
-  if (results_available) { // wait until at least one result is available in the buffer
+  // wait until the current profile's batch is buffered and its processing interval has elapsed
+  if (results_available >= proc_batch_sz && now - last_proc >= proc_interval) {
+    last_proc = now;
     // process the batch of ADC readings
     const uint8_t sreg = SREG;
     cli(); // disable interrupts for atomicity. note that interrupts received aren't discarded, they just aren't serviced
@@ -221,16 +293,24 @@ void loop() {
     results_available = 0;
     SREG = sreg; // re-enable interrupts
 
+#if ACQ_BENCH
+    const measurement_mode_t bench_mode = cur_mode;
+    const uint32_t bench_start = micros();
+#endif
+
     if (lcd_can_draw()) {
       // first, check the current mode
       if (cur_mode == MODE_AUTO) {
         if (sample_channel == PDIODE_A_CH) {
-          if (results_proc[0].val < 5) { // reading sharply falls to 0 when finger first placed
+          sqi_update(results_proc[0].val);
+          // reading sharply falls to 0 when finger first placed, but a clean pulse is an even surer sign
+          const uint8_t dark = sqi_flags() & SQI_DARK;
+          if (dark || sqi_quality() >= SQI_GOOD) {
             if (!last_pd_in_thres) { // first reading in thres
               first_pd_in_thres_time = now;
               last_pd_in_thres = 1;
             }
-            if (now - first_pd_in_thres_time > 1000) { // probably have a finger
+            if (now - first_pd_in_thres_time > (dark ? AUTO_DWELL_DARK : AUTO_DWELL_PULSE)) { // probably have a finger
               change_mode(MODE_HEARTBEAT, 0);
               Serial.print(F("Switch to heartbeat: "));
               Serial.println(results_proc[0].val);
@@ -250,14 +330,20 @@ void loop() {
           }
         }
       } else if (cur_mode == MODE_HEARTBEAT) {
-        for (uint8_t i = 0; i < results_count; ++i) { // process everything in the batch
-          process_raw_reading(&results_proc[i]);
-          // Serial.println(results_proc[i].val);
-        }
+        process_hr_batch(results_proc, results_count); // process everything in the batch
       } else if (cur_mode == MODE_GLUCOSE) {
-        process_glucose_reading(&results_proc[0]);
+        process_glucose_batch(results_proc, results_count);
       }
     }
+
+#if ACQ_BENCH
+    // latency: age of the oldest sample in the batch once it has been processed
+    Serial.print(F("bench mode: ")); Serial.print(bench_mode);
+    Serial.print(F(" n: ")); Serial.print(results_count);
+    Serial.print(F(" latency: ")); Serial.print(millis() - results_proc[0].t);
+    Serial.print(F("ms proc: ")); Serial.print(micros() - bench_start);
+    Serial.println(F("us"));
+#endif
   }
 
   // Check if mode pot position changed
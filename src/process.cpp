@@ -2,12 +2,18 @@
 #include <Arduino.h>
 
 #include "lcd.h"
+#include "beat.h"
+#include "sqi.h"
 
 #include "pins.h"
 
 // HR params
 #define HYSTERESIS_THRES 100
-#define AVG_NUM 10
+// Bounds (in ms) of the no-beat timeout, which otherwise scales with the mean beat interval
+#define NO_BEAT_TIMEOUT_MIN 1000
+#define NO_BEAT_TIMEOUT_MAX 2000
+// Time (in ms) the signal quality may stay poor before the finger is considered gone
+#define POOR_SIGNAL_TIMEOUT 500
 
 // Glucose params
 #define READING_W 427
@@ -20,21 +26,48 @@ static uint8_t cycle = 1; // 1 = rising, 0 = falling
 static uint32_t last_max_time = 0, max_time = 0; // tick of last rise
 static uint32_t last_graphic_update = 0;
 static uint8_t has_finger = 1;
-static uint16_t past_bpm[AVG_NUM];
-static uint8_t past_bpm_pos = 0;
+static uint32_t last_usable_time = 0; // tick of last sample with usable (or dark) signal
 
 void process_init_hb() {
   has_finger = 0;
   last_max_time = millis();
   last_high_margin = 0;
   last_low_margin = 0;
-  past_bpm_pos = 0; 
-  memset(past_bpm, 0, sizeof(past_bpm));
+  last_usable_time = last_max_time;
+  beat_reset();
+  sqi_reset();
 }
 
-void process_raw_reading(adc_sample_t * sample) {
+/**
+ * Time without a beat after which the finger is considered gone: 2.5 beat intervals, bounded
+ */
+static uint16_t no_beat_timeout() {
+  const uint16_t mean_rr = beat_mean_rr();
+  if (!mean_rr) return NO_BEAT_TIMEOUT_MAX;
+  const uint16_t timeout = mean_rr * 5 / 2;
+  if (timeout < NO_BEAT_TIMEOUT_MIN) return NO_BEAT_TIMEOUT_MIN;
+  if (timeout > NO_BEAT_TIMEOUT_MAX) return NO_BEAT_TIMEOUT_MAX;
+  return timeout;
+}
+
+// Events raised by the numeric pass over a batch, for the UI/telemetry pass
+#define HR_EVT_BEAT   (1<<0) // peak accepted, pulse now falling
+#define HR_EVT_RISE   (1<<1) // trough accepted, pulse now rising
+#define HR_EVT_FINGER (1<<2) // first beat since finger was (re)detected
+
+static uint16_t beat_margin = 0, rise_margin = 0; // margins of last accepted peak/trough
+static uint16_t beat_rr = 0; // interval (ms) of last accepted beat, 0 if it only set the reference peak
+
+/**
+ * Advance the beat detector by one sample, without touching the LCD or serial
+ */
+static uint8_t hr_step(const adc_sample_t * sample) {
   const uint16_t val = sample->val; // value of sample
   const uint32_t now = sample->t; // time sample was completed
+  uint8_t events = 0;
+
+  sqi_update(val);
+  if ((sqi_flags() & SQI_DARK) || sqi_quality() >= SQI_POOR) last_usable_time = now;
 
   if (cycle == 1) { // rising portion of pulse
     if (val > cycle_max) {
@@ -46,33 +79,22 @@ void process_raw_reading(adc_sample_t * sample) {
       const uint32_t diff = max_time - last_max_time; // time difference between 2 peaks
       if (diff > 250 && margin > last_high_margin * 4/5) { // cap at 240bpm, 60/240 = 250ms
         cycle = 0;
+        events |= HR_EVT_BEAT;
+        beat_margin = margin;
 
-        // maintain running average
-        uint16_t bpm = 60000/diff;
-        Serial.print(F("falling, margin: ")); Serial.print(margin);
-        Serial.print(F(" BPM: ")); Serial.println(60000 / diff);
-
+        // maintain running interval stats, starting afresh once a finger is (re)detected.
+        // The first peak after (re)detection, or after a gap too long to be one beat, only
+        // becomes the reference for the next interval
         if (!has_finger) {
-          for (uint8_t i = 0; i < AVG_NUM; ++i) past_bpm[i] = bpm;
-        } else {
-          past_bpm[past_bpm_pos] = bpm;
+          beat_reset();
+          events |= HR_EVT_FINGER;
         }
-        ++past_bpm_pos;
-        if (past_bpm_pos >= AVG_NUM) past_bpm_pos = 0;
-
-        if (lcd_can_draw()) {
-          if (!has_finger) { // need to clear previous text
-            lcd.setCursor(0, 1);
-            lcd.print(F("                   "));
-          }
-          lcd.setCursor(0, 1);
-          lcd.print(F("Heart rate: "));
-          uint16_t s = 0;
-          for (uint8_t i = 0; i < AVG_NUM; ++i) s += past_bpm[i];
-          lcd.print(s / AVG_NUM);
-          lcd.print(F("BPM  "));
-          lcd.setCursor(19, 1);
-          lcd.write(LCD_CHAR_HEART_LG);
+        if ((events & HR_EVT_FINGER) || diff > BEAT_RR_MAX) {
+          beat_rr = 0;
+        } else {
+          beat_rr = diff;
+          beat_add(beat_rr);
+          sqi_beat(beat_rr, beat_mean_rr());
         }
         has_finger = 1;
 
@@ -81,7 +103,6 @@ void process_raw_reading(adc_sample_t * sample) {
           last_max = cycle_max + 5;
         // }
         cycle_min = val;
-        digitalWrite(HB_LED_PIN, cycle);
         last_max_time = max_time;
         last_high_margin = margin;
       } else {
@@ -99,37 +120,80 @@ void process_raw_reading(adc_sample_t * sample) {
 
       if (margin > last_low_margin * 4/5) {
         cycle = 1;
+        events |= HR_EVT_RISE;
+        rise_margin = margin;
         last_min = cycle_min;
-        // printf("rising, val: %lu, margin: %lu\n", val, cycle_max - cycle_min);
-        Serial.print(F("rising, margin: "));
-        Serial.println(margin);
         cycle_max = val;
-        digitalWrite(HB_LED_PIN, cycle);
-
-        if (lcd_can_draw()) {
-          lcd.setCursor(19, 1);
-          lcd.write(LCD_CHAR_HEART_SM);
-        }
       }
       last_low_margin = margin;
     }
   }
 
+  return events;
+}
+
+void process_hr_batch(const adc_sample_t * samples, uint8_t n) {
+  if (!n) return;
+
+  // run the detector over the whole batch first, then update outputs once from the final state
+  uint8_t events = 0;
+  for (uint8_t i = 0; i < n; ++i) events |= hr_step(&samples[i]);
+
+  const uint16_t val = samples[n-1].val; // value of latest sample
+  const uint32_t now = samples[n-1].t; // time latest sample was completed
+
+  if (events & HR_EVT_RISE) {
+    Serial.print(F("rising, margin: "));
+    Serial.println(rise_margin);
+  }
+  if (events & HR_EVT_BEAT) {
+    Serial.print(F("falling, margin: ")); Serial.print(beat_margin);
+    if (beat_rr) {
+      Serial.print(F(" BPM: ")); Serial.println(60000 / beat_rr);
+      beat_print_stats();
+    } else {
+      Serial.println();
+    }
+  }
+  if (events & (HR_EVT_BEAT | HR_EVT_RISE)) digitalWrite(HB_LED_PIN, cycle);
+
+  if (!lcd_can_draw()) return;
+
+  if (events & HR_EVT_BEAT) {
+    if (events & HR_EVT_FINGER) { // need to clear previous text
+      lcd.setCursor(0, 1);
+      lcd.print(F("                   "));
+    }
+    lcd.setCursor(0, 1);
+    lcd.print(F("Heart rate: "));
+    const uint16_t bpm = beat_mean_bpm();
+    if (bpm) lcd.print(bpm);
+    else lcd.print(F("--"));
+    lcd.print(F("BPM  "));
+  }
+  if (events & (HR_EVT_BEAT | HR_EVT_RISE)) {
+    lcd.setCursor(19, 1);
+    lcd.write(cycle ? LCD_CHAR_HEART_SM : LCD_CHAR_HEART_LG);
+  }
+
   uint32_t real_now = millis();
-  if (real_now - last_graphic_update > 50 && lcd_can_draw()) {
+  if (real_now - last_graphic_update > 50) {
     uint8_t rescale_val = (val - last_min) * 20 / (last_max - last_min);
     Serial.print(F("val: "));
     Serial.print(val);
     Serial.print(F(", rescale: "));
-    Serial.println(rescale_val);
+    Serial.print(rescale_val);
+    Serial.print(F(", sqi: "));
+    Serial.println(sqi_quality());
     for (uint8_t x = 0; x < 20; ++x) {
       lcd.setCursor(x, 3);
       lcd.write(x <= rescale_val ? 0xff : ' ');
     }
     last_graphic_update = real_now;
 
-    if (now - last_max_time > 2000 && has_finger) { // no beat for at least 3s -> probably no finger
-      if (val == 0) {
+    // no beat for a few intervals, or no pulsatile signal -> probably no finger
+    if (has_finger && (now - last_max_time > no_beat_timeout() || now - last_usable_time > POOR_SIGNAL_TIMEOUT)) {
+      if (sqi_flags() & SQI_DARK) {
         lcd.setCursor(0, 1);
         lcd.print(F("Reading..."));
       } else {
@@ -151,10 +215,13 @@ void process_init_glucose() {
   last_glucose_valid_time = millis();
 }
 
-void process_glucose_reading(adc_sample_t * sample) {
-  if (!lcd_can_draw()) return;
+void process_glucose_batch(const adc_sample_t * samples, uint8_t n) {
+  if (!n || !lcd_can_draw()) return;
 
-  const uint16_t val = sample->val;
+  // average the batch, then update the display once
+  uint32_t sum = 0;
+  for (uint8_t i = 0; i < n; ++i) sum += samples[i].val;
+  const uint16_t val = sum / n;
   const uint32_t now = millis();
   if (val > 170) { // probably no cuvette inserted
     if (now - last_glucose_valid_time > INACTIVITY_TIMEOUT) {
@@ -172,6 +239,8 @@ void process_glucose_reading(adc_sample_t * sample) {
     lcd.setCursor(18, 2); lcd.write(0xff);
 
     double conc = (log10((double) READING_W / (double) val)-0.0224) / 0.0335;
+    Serial.print(F("glucose: ")); Serial.print(conc);
+    Serial.print(F(" val: ")); Serial.println(val);
 
     lcd.setCursor(0, 2);
     lcd.print(F("Conc: "));
@@ -0,0 +1,66 @@
+#include "sqi.h"
+
+// Samples at or below this are considered saturated dark
+#define SQI_DARK_THRES 5
+// Samples at or above this are considered clipped
+#define SQI_CLIP_THRES 1015
+// EMA smoothing factor of 1/2^n for the DC and AC estimates
+#define SQI_EMA_SHIFT 4
+// Perfusion index (1/1000) at which the perfusion score saturates
+#define SQI_PI_FULL 100
+// Below this DC level, quantisation noise alone gives a meaningless perfusion index
+#define SQI_DC_MIN 50
+// Max score contributed by perfusion and by beat consistency respectively
+#define SQI_PERF_MAX 60
+#define SQI_CONS_MAX 40
+
+// Fixed-point (x 2^SQI_EMA_SHIFT) running estimates
+static uint32_t dc_q = 0, ac_q = 0;
+static uint8_t seeded = 0;
+static uint8_t flags = 0;
+static uint8_t consistency = 0;
+
+void sqi_reset() {
+  dc_q = ac_q = 0;
+  seeded = 0;
+  flags = 0;
+  consistency = 0;
+}
+
+void sqi_update(uint16_t val) {
+  if (!seeded) {
+    dc_q = (uint32_t) val << SQI_EMA_SHIFT;
+    seeded = 1;
+  }
+  const uint16_t dc = dc_q >> SQI_EMA_SHIFT;
+  const uint16_t dev = val > dc ? val - dc : dc - val;
+  dc_q = dc_q - (dc_q >> SQI_EMA_SHIFT) + val;
+  ac_q = ac_q - (ac_q >> SQI_EMA_SHIFT) + dev;
+
+  flags = (val <= SQI_DARK_THRES ? SQI_DARK : 0) | (val >= SQI_CLIP_THRES ? SQI_CLIPPED : 0);
+}
+
+void sqi_beat(uint16_t rr, uint16_t mean_rr) {
+  if (!mean_rr) return;
+  const uint16_t dev = rr > mean_rr ? rr - mean_rr : mean_rr - rr;
+  const uint32_t dev_pct = (uint32_t) dev * 100 / mean_rr;
+  // full score when within 0% of mean, none beyond 20%
+  const uint8_t score = dev_pct >= 20 ? 0 : SQI_CONS_MAX - dev_pct * SQI_CONS_MAX / 20;
+  consistency = ((uint16_t) consistency * 3 + score) / 4;
+}
+
+uint8_t sqi_flags() {
+  return flags;
+}
+
+uint16_t sqi_perfusion() {
+  if ((dc_q >> SQI_EMA_SHIFT) < SQI_DC_MIN) return 0;
+  return ac_q * 1000 / dc_q; // both share the fixed-point scale
+}
+
+uint8_t sqi_quality() {
+  if (flags) return 0; // saturated either way, no usable pulse
+  const uint16_t pi = sqi_perfusion();
+  const uint8_t perf = pi >= SQI_PI_FULL ? SQI_PERF_MAX : pi * SQI_PERF_MAX / SQI_PI_FULL;
+  return perf + consistency;
+}
@@ -0,0 +1,33 @@
+#!/bin/sh
+# Replays the testdata captures through pseudo-terminals into telemd (with a small
+# ring, so heartbeat.txt wraps) and compares the dump, minus host timestamps,
+# against testdata/expected.csv
+set -e
+cd "$(dirname "$0")"
+
+captures="heartbeat glucose decoder"
+tmp=$(mktemp -d)
+trap 'rm -rf "$tmp"' EXIT
+
+: > "$tmp/ptys"
+./ttyreplay -t 5000 $(for c in $captures; do echo "testdata/$c.txt"; done) > "$tmp/ptys" &
+replay=$!
+while [ "$(wc -l < "$tmp/ptys")" -lt 3 ]; do
+  kill -0 "$replay" 2> /dev/null || { echo "ttyreplay failed" >&2; exit 1; }
+  sleep 0.05
+done
+
+./telemd -c 8 -o "$tmp/out.tcol" $(cat "$tmp/ptys") 2> "$tmp/telemd.err" || { cat "$tmp/telemd.err" >&2; exit 1; }
+wait $replay
+
+# name each device after its capture instead of its (unpredictable) pty path
+i=1
+cp /dev/null "$tmp/names.sed"
+for c in $captures; do
+  echo "s#^$(sed -n "${i}p" "$tmp/ptys"),#$c,#" >> "$tmp/names.sed"
+  i=$((i + 1))
+done
+
+./telemd -d "$tmp/out.tcol" | sed -f "$tmp/names.sed" | cut -d, -f1,3,4 > "$tmp/out.csv"
+diff -u testdata/expected.csv "$tmp/out.csv"
+echo "telemetry check passed"
@@ -0,0 +1,127 @@
+#include "telemetry.h"
+
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+static size_t pad8(size_t n) {
+  return (n + 7) & ~(size_t) 7;
+}
+
+static size_t dev_region_size(uint32_t capacity) {
+  return pad8((size_t) capacity * (sizeof(int64_t) + sizeof(int32_t) + sizeof(uint8_t)));
+}
+
+static size_t dev_region_offset(uint16_t n_dev, uint32_t capacity, uint16_t dev) {
+  return sizeof(col_file_hdr_t) + pad8(n_dev * sizeof(col_dev_hdr_t)) + dev * dev_region_size(capacity);
+}
+
+static int col_map(col_file_t * f, int prot) {
+  f->base = (uint8_t *) mmap(NULL, f->size, prot, MAP_SHARED, f->fd, 0);
+  if (f->base == MAP_FAILED) {
+    perror("mmap");
+    close(f->fd);
+    return -1;
+  }
+  f->hdr = (col_file_hdr_t *) f->base;
+  f->devs = (col_dev_hdr_t *) (f->base + sizeof(col_file_hdr_t));
+  return 0;
+}
+
+int col_create(col_file_t * f, const char * path, const char * const * names, uint16_t n_dev, uint32_t capacity) {
+  f->fd = open(path, O_RDWR | O_CREAT | O_TRUNC, 0644);
+  if (f->fd < 0) {
+    perror(path);
+    return -1;
+  }
+  f->size = dev_region_offset(n_dev, capacity, n_dev);
+  if (ftruncate(f->fd, f->size) < 0) { // sparse; pages are only backed once written
+    perror("ftruncate");
+    close(f->fd);
+    return -1;
+  }
+  if (col_map(f, PROT_READ | PROT_WRITE) < 0) return -1;
+
+  f->hdr->magic = COL_MAGIC;
+  f->hdr->version = COL_VERSION;
+  f->hdr->n_dev = n_dev;
+  f->hdr->capacity = capacity;
+  for (uint16_t i = 0; i < n_dev; ++i) {
+    strncpy(f->devs[i].name, names[i], sizeof(f->devs[i].name) - 1);
+    f->devs[i].count = f->devs[i].begun = 0;
+  }
+  return 0;
+}
+
+int col_open(col_file_t * f, const char * path) {
+  f->fd = open(path, O_RDONLY);
+  if (f->fd < 0) {
+    perror(path);
+    return -1;
+  }
+  struct stat st;
+  if (fstat(f->fd, &st) < 0 || (size_t) st.st_size < sizeof(col_file_hdr_t)) {
+    fprintf(stderr, "%s: not a telemetry file\n", path);
+    close(f->fd);
+    return -1;
+  }
+  f->size = st.st_size;
+  if (col_map(f, PROT_READ) < 0) return -1;
+
+  if (f->hdr->magic != COL_MAGIC || f->hdr->version != COL_VERSION
+      || f->size < dev_region_offset(f->hdr->n_dev, f->hdr->capacity, f->hdr->n_dev)) {
+    fprintf(stderr, "%s: not a telemetry file\n", path);
+    col_close(f);
+    return -1;
+  }
+  return 0;
+}
+
+int64_t * col_t(col_file_t * f, uint16_t dev) {
+  return (int64_t *) (f->base + dev_region_offset(f->hdr->n_dev, f->hdr->capacity, dev));
+}
+
+int32_t * col_val(col_file_t * f, uint16_t dev) {
+  return (int32_t *) (col_t(f, dev) + f->hdr->capacity);
+}
+
+uint8_t * col_kind(col_file_t * f, uint16_t dev) {
+  return (uint8_t *) (col_val(f, dev) + f->hdr->capacity);
+}
+
+void col_append(col_file_t * f, uint16_t dev, int64_t t, const rec_t * rec) {
+  col_dev_hdr_t * d = &f->devs[dev];
+  const uint64_t count = d->count;
+  const uint32_t idx = count % f->hdr->capacity;
+  // announce the overwrite of the slot before touching it
+  __atomic_store_n(&d->begun, count + 1, __ATOMIC_RELAXED);
+  __atomic_thread_fence(__ATOMIC_RELEASE);
+  col_t(f, dev)[idx] = t;
+  col_val(f, dev)[idx] = rec->val;
+  col_kind(f, dev)[idx] = rec->kind;
+  // publish only once the columns are written, so concurrent readers never see a partial record
+  __atomic_store_n(&d->count, count + 1, __ATOMIC_RELEASE);
+}
+
+int col_read(col_file_t * f, uint16_t dev, uint64_t i, int64_t * t, rec_t * rec) {
+  col_dev_hdr_t * d = &f->devs[dev];
+  const uint32_t cap = f->hdr->capacity;
+  if (i >= __atomic_load_n(&d->count, __ATOMIC_ACQUIRE)) return -1;
+
+  const uint32_t idx = i % cap;
+  *t = col_t(f, dev)[idx];
+  rec->val = col_val(f, dev)[idx];
+  rec->kind = col_kind(f, dev)[idx];
+
+  // the copy is only valid if the writer hadn't begun reusing the slot by now
+  __atomic_thread_fence(__ATOMIC_ACQUIRE);
+  return __atomic_load_n(&d->begun, __ATOMIC_RELAXED) > i + cap ? -1 : 0;
+}
+
+void col_close(col_file_t * f) {
+  munmap(f->base, f->size);
+  close(f->fd);
+}
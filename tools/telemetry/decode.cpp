@@ -0,0 +1,116 @@
+#include "telemetry.h"
+
+#include <string.h>
+
+void dec_init(line_dec_t * dec) {
+  dec->len = 0;
+  dec->overflow = 0;
+}
+
+size_t dec_feed(line_dec_t * dec, const char * buf, size_t len, rec_t recs[LINE_MAX_RECS], uint8_t * n_recs) {
+  *n_recs = 0;
+  for (size_t i = 0; i < len; ++i) {
+    const char c = buf[i];
+    if (c == '\n') {
+      if (!dec->overflow) {
+        if (dec->len && dec->line[dec->len-1] == '\r') --dec->len; // Serial.println() ends with CRLF
+        dec->line[dec->len] = '\0';
+        *n_recs = dec_parse_line(dec->line, recs);
+      }
+      dec_init(dec);
+      return i + 1;
+    }
+    if (dec->overflow) continue;
+    if (dec->len >= LINE_MAX_LEN - 1) { // no room for terminator; drop this line
+      dec->overflow = 1;
+      continue;
+    }
+    dec->line[dec->len++] = c;
+  }
+  return len;
+}
+
+/**
+ * Parse a decimal integer, returning a pointer past it, or NULL if there are no digits
+ */
+static const char * parse_int(const char * s, int32_t * out) {
+  uint8_t neg = 0;
+  if (*s == '-') {
+    neg = 1;
+    ++s;
+  }
+  if (*s < '0' || *s > '9') return NULL;
+  int64_t v = 0;
+  while (*s >= '0' && *s <= '9') {
+    if (v < INT32_MAX) v = v * 10 + (*s - '0');
+    ++s;
+  }
+  if (v > INT32_MAX) v = INT32_MAX;
+  *out = neg ? -v : v;
+  return s;
+}
+
+/**
+ * Parse a decimal number as fixed point with 3 decimal places (e.g. "5.43" -> 5430)
+ */
+static const char * parse_milli(const char * s, int32_t * out) {
+  const uint8_t neg = *s == '-';
+  int32_t whole;
+  s = parse_int(s, &whole);
+  if (!s || whole > INT32_MAX / 1000 || whole < -INT32_MAX / 1000) return NULL;
+  int32_t frac = 0, scale = 100;
+  if (*s == '.') {
+    for (++s; *s >= '0' && *s <= '9'; ++s) {
+      frac += (*s - '0') * scale;
+      scale /= 10;
+    }
+  }
+  *out = neg ? whole * 1000 - frac : whole * 1000 + frac;
+  return s;
+}
+
+/**
+ * Find `key` in `line` and parse the integer following it
+ */
+static uint8_t field_int(const char * line, const char * key, int32_t * out) {
+  const char * p = strstr(line, key);
+  return p && parse_int(p + strlen(key), out);
+}
+
+static uint8_t starts_with(const char * line, const char * prefix) {
+  return strncmp(line, prefix, strlen(prefix)) == 0;
+}
+
+uint8_t dec_parse_line(const char * line, rec_t recs[LINE_MAX_RECS]) {
+  uint8_t n = 0;
+  int32_t v;
+
+  if (starts_with(line, "falling, ")) { // "falling, margin: <m> BPM: <bpm>"
+    if (field_int(line, "BPM: ", &v)) recs[n++] = (rec_t) { REC_BPM, v };
+  } else if (starts_with(line, "hrv, ")) { // "hrv, rr: <ms> mean: ... rmssd: <ms>"
+    if (field_int(line, "rr: ", &v)) recs[n++] = (rec_t) { REC_RR, v };
+    if (field_int(line, "rmssd: ", &v)) recs[n++] = (rec_t) { REC_RMSSD, v };
+  } else if (starts_with(line, "val: ")) { // "val: <val>, rescale: <r>, sqi: <q>"
+    if (field_int(line, "val: ", &v)) recs[n++] = (rec_t) { REC_RAW, v };
+    if (field_int(line, "sqi: ", &v)) recs[n++] = (rec_t) { REC_SQI, v };
+  } else if (starts_with(line, "glucose: ")) { // "glucose: <mM> val: <val>"
+    if (parse_milli(line + strlen("glucose: "), &v)) recs[n++] = (rec_t) { REC_GLUCOSE, v };
+  } else if (starts_with(line, "mode: ")) { // "mode: <mode>"
+    if (field_int(line, "mode: ", &v)) recs[n++] = (rec_t) { REC_MODE, v };
+  }
+
+  return n;
+}
+
+const char * rec_kind_name(uint8_t kind) {
+  switch (kind) {
+    case REC_BPM: return "bpm";
+    case REC_RR: return "rr";
+    case REC_RMSSD: return "rmssd";
+    case REC_SQI: return "sqi";
+    case REC_RAW: return "raw";
+    case REC_GLUCOSE: return "glucose";
+    case REC_MODE: return "mode";
+    default: return "?";
+  }
+}
@@ -0,0 +1,218 @@
+/**
+ * Telemetry ingestion daemon
+ *
+ * Reads the serial output of any number of boards at once and records the
+ * decoded time series into a memory-mapped columnar file (see telemetry.h).
+ *
+ *   telemd [-c capacity] -o out.tcol /dev/ttyACM0 /dev/ttyUSB0 ...
+ *   telemd -d out.tcol    # dump recorded series as CSV
+ */
+#include "telemetry.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/epoll.h>
+#include <sys/mman.h>
+#include <termios.h>
+#include <time.h>
+#include <unistd.h>
+
+// Serial baud rate of the firmware (see platformio.ini)
+#define TTY_BAUD B500000
+// Default records kept per device before the oldest are overwritten
+#define DEFAULT_CAPACITY (1u << 20)
+
+typedef struct {
+  int fd;
+  line_dec_t dec;
+} device_t;
+
+static volatile sig_atomic_t stop = 0;
+
+static void on_signal(int) {
+  stop = 1;
+}
+
+static int64_t now_ms() {
+  struct timespec ts;
+  clock_gettime(CLOCK_REALTIME, &ts);
+  return (int64_t) ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+/**
+ * Open a tty non-blocking and put it in raw mode at the firmware's baud rate
+ */
+static int tty_open(const char * path) {
+  const int fd = open(path, O_RDONLY | O_NOCTTY | O_NONBLOCK);
+  if (fd < 0) {
+    perror(path);
+    return -1;
+  }
+  struct termios tio;
+  if (tcgetattr(fd, &tio) == 0) {
+    cfmakeraw(&tio);
+    cfsetispeed(&tio, TTY_BAUD); // ignored by pseudo-terminals
+    cfsetospeed(&tio, TTY_BAUD);
+    tio.c_cflag |= CLOCAL | CREAD;
+    tcsetattr(fd, TCSANOW, &tio);
+  }
+  return fd;
+}
+
+/**
+ * Drain all pending input of a device into the columnar file
+ *
+ * Returns -1 once the device has hung up or failed.
+ */
+static int device_drain(device_t * dev, uint16_t idx, col_file_t * col) {
+  char buf[4096];
+  for (;;) {
+    const ssize_t n = read(dev->fd, buf, sizeof(buf));
+    if (n < 0) {
+      if (errno == EAGAIN || errno == EINTR) return 0;
+      if (errno != EIO) perror(col->devs[idx].name); // EIO: pty master closed
+      return -1;
+    }
+    if (n == 0) return -1;
+
+    const int64_t t = now_ms();
+    size_t off = 0;
+    while (off < (size_t) n) {
+      rec_t recs[LINE_MAX_RECS];
+      uint8_t n_recs;
+      off += dec_feed(&dev->dec, buf + off, n - off, recs, &n_recs);
+      for (uint8_t i = 0; i < n_recs; ++i) col_append(col, idx, t, &recs[i]);
+    }
+  }
+}
+
+static int record(const char * out, const char * const * paths, uint16_t n_dev, uint32_t capacity) {
+  col_file_t col;
+  if (col_create(&col, out, paths, n_dev, capacity) < 0) return 1;
+
+  device_t * devs = (device_t *) calloc(n_dev, sizeof(device_t));
+  const int ep = epoll_create1(0);
+  if (!devs || ep < 0) {
+    perror("init");
+    if (ep >= 0) close(ep);
+    free(devs);
+    col_close(&col);
+    return 1;
+  }
+
+  uint16_t open_devs = 0;
+  for (uint16_t i = 0; i < n_dev; ++i) {
+    dec_init(&devs[i].dec);
+    devs[i].fd = tty_open(paths[i]);
+    if (devs[i].fd < 0) continue;
+    struct epoll_event ev = {};
+    ev.events = EPOLLIN;
+    ev.data.u32 = i;
+    if (epoll_ctl(ep, EPOLL_CTL_ADD, devs[i].fd, &ev) < 0) {
+      perror("epoll_ctl");
+      close(devs[i].fd);
+      devs[i].fd = -1;
+      continue;
+    }
+    ++open_devs;
+  }
+  if (!open_devs) {
+    fprintf(stderr, "no device could be opened\n");
+    close(ep);
+    free(devs);
+    col_close(&col);
+    return 1;
+  }
+
+  struct sigaction sa = {};
+  sa.sa_handler = on_signal;
+  sigaction(SIGINT, &sa, NULL);
+  sigaction(SIGTERM, &sa, NULL);
+
+  // run until interrupted or every device has gone away
+  struct epoll_event events[32];
+  while (!stop && open_devs) {
+    const int n = epoll_wait(ep, events, sizeof(events) / sizeof(events[0]), -1);
+    if (n < 0) {
+      if (errno == EINTR) continue;
+      perror("epoll_wait");
+      break;
+    }
+    for (int i = 0; i < n; ++i) {
+      const uint16_t idx = events[i].data.u32;
+      device_t * dev = &devs[idx];
+      if (dev->fd < 0) continue;
+      // on hangup, still drain whatever was buffered before the device went away
+      if (device_drain(dev, idx, &col) < 0 || (events[i].events & (EPOLLHUP | EPOLLERR))) {
+        fprintf(stderr, "%s: closed after %llu records\n", col.devs[idx].name, (unsigned long long) col.devs[idx].count);
+        epoll_ctl(ep, EPOLL_CTL_DEL, dev->fd, NULL);
+        close(dev->fd);
+        dev->fd = -1;
+        --open_devs;
+      }
+    }
+  }
+
+  for (uint16_t i = 0; i < n_dev; ++i) if (devs[i].fd >= 0) close(devs[i].fd);
+  close(ep);
+  free(devs);
+  msync(col.base, col.size, MS_SYNC);
+  col_close(&col);
+  return 0;
+}
+
+static int dump(const char * path) {
+  col_file_t col;
+  if (col_open(&col, path) < 0) return 1;
+
+  printf("device,t_ms,kind,val\n");
+  const uint32_t cap = col.hdr->capacity;
+  for (uint16_t d = 0; d < col.hdr->n_dev; ++d) {
+    const uint64_t count = __atomic_load_n(&col.devs[d].count, __ATOMIC_ACQUIRE);
+    for (uint64_t i = count > cap ? count - cap : 0; i < count; ++i) {
+      int64_t t;
+      rec_t rec;
+      if (col_read(&col, d, i, &t, &rec) < 0) continue; // overwritten while recording
+      printf("%s,%lld,%s,%d\n", col.devs[d].name, (long long) t, rec_kind_name(rec.kind), rec.val);
+    }
+  }
+  col_close(&col);
+  return 0;
+}
+
+static void usage() {
+  fprintf(stderr,
+    "usage: telemd [-c capacity] -o FILE DEVICE...\n"
+    "       telemd -d FILE\n");
+}
+
+int main(int argc, char ** argv) {
+  const char * out = NULL;
+  uint32_t capacity = DEFAULT_CAPACITY;
+  int opt;
+  while ((opt = getopt(argc, argv, "c:o:d:h")) != -1) {
+    switch (opt) {
+      case 'c':
+        capacity = strtoul(optarg, NULL, 0);
+        break;
+      case 'o':
+        out = optarg;
+        break;
+      case 'd':
+        return dump(optarg);
+      default:
+        usage();
+        return opt == 'h' ? 0 : 2;
+    }
+  }
+  const int n_dev = argc - optind;
+  if (!out || n_dev <= 0 || n_dev > UINT16_MAX || !capacity) {
+    usage();
+    return 2;
+  }
+  return record(out, (const char * const *) argv + optind, n_dev, capacity);
+}
@@ -0,0 +1,137 @@
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+
+/**
+ * Kind of a decoded telemetry record
+ */
+typedef enum {
+  REC_BPM = 1,  // instantaneous heart rate, BPM
+  REC_RR,       // beat interval, ms
+  REC_RMSSD,    // RMSSD over the firmware's beat window, ms
+  REC_SQI,      // signal-quality index, 0-100
+  REC_RAW,      // raw photodiode sample (throttled by the firmware)
+  REC_GLUCOSE,  // glucose concentration, uM (i.e. mM x 1000)
+  REC_MODE,     // new `measurement_mode_t`
+} rec_kind_t;
+
+/**
+ * One decoded record
+ */
+typedef struct {
+  uint8_t kind;
+  int32_t val;
+} rec_t;
+
+// Longest serial line kept; longer lines are discarded
+#define LINE_MAX_LEN 128
+// Most records produced by a single line
+#define LINE_MAX_RECS 3
+
+/**
+ * Incremental line decoder, one per device
+ */
+typedef struct {
+  char line[LINE_MAX_LEN];
+  uint16_t len;
+  /**
+   * Set while skipping the remainder of an over-long line
+   */
+  uint8_t overflow;
+} line_dec_t;
+
+void dec_init(line_dec_t * dec);
+
+/**
+ * Feed bytes into the decoder
+ *
+ * Returns the number of bytes consumed. Consumption stops right after a complete
+ * line; `*n_recs` is then set to the number of records decoded from it (possibly 0).
+ * If the input runs out first, all of it is consumed and `*n_recs` is 0.
+ */
+size_t dec_feed(line_dec_t * dec, const char * buf, size_t len, rec_t recs[LINE_MAX_RECS], uint8_t * n_recs);
+
+/**
+ * Decode one complete line (without terminator), returning the number of records
+ */
+uint8_t dec_parse_line(const char * line, rec_t recs[LINE_MAX_RECS]);
+
+/*
+ * Columnar file layout, all integers little-endian:
+ *
+ *   col_file_hdr_t
+ *   col_dev_hdr_t[n_dev]
+ *   per device: int64_t t[capacity] | int32_t val[capacity] | uint8_t kind[capacity] (padded to 8 bytes)
+ *
+ * Each device's columns form a ring: record i lives at index i % capacity, and
+ * `count` is the total number of records ever written to that device.
+ *
+ * Readers may run concurrently with the writer: after copying record i out, a
+ * reader re-checks `begun` and drops the copy if record i + capacity (which
+ * reuses the slot) had started being written. See col_read().
+ */
+#define COL_MAGIC 0x4c4f4354 // "TCOL"
+#define COL_VERSION 1
+
+typedef struct {
+  uint32_t magic;
+  uint16_t version;
+  uint16_t n_dev;
+  uint32_t capacity;
+  uint32_t reserved;
+} col_file_hdr_t;
+
+typedef struct {
+  /**
+   * Device path, NUL terminated (truncated if too long)
+   */
+  char name[48];
+  /**
+   * Records written so far; published after the record's columns
+   */
+  uint64_t count;
+  /**
+   * Records whose write has started; bumped before the record's columns
+   */
+  uint64_t begun;
+} col_dev_hdr_t;
+
+typedef struct {
+  int fd;
+  uint8_t * base;
+  size_t size;
+  col_file_hdr_t * hdr;
+  col_dev_hdr_t * devs;
+} col_file_t;
+
+/**
+ * Create (or truncate) and map a columnar file for `n_dev` devices
+ */
+int col_create(col_file_t * f, const char * path, const char * const * names, uint16_t n_dev, uint32_t capacity);
+
+/**
+ * Map an existing columnar file read-only
+ */
+int col_open(col_file_t * f, const char * path);
+
+/**
+ * Append one record to a device's columns
+ */
+void col_append(col_file_t * f, uint16_t dev, int64_t t, const rec_t * rec);
+
+int64_t * col_t(col_file_t * f, uint16_t dev);
+/**
+ * Copy record `i` of a device out of its ring
+ *
+ * Returns -1 if the record is no longer (or not yet) available, or was being
+ * overwritten while it was copied.
+ */
+int col_read(col_file_t * f, uint16_t dev, uint64_t i, int64_t * t, rec_t * rec);
+
+int32_t * col_val(col_file_t * f, uint16_t dev);
+uint8_t * col_kind(col_file_t * f, uint16_t dev);
+
+void col_close(col_file_t * f);
+
+const char * rec_kind_name(uint8_t kind);
@@ -0,0 +1,169 @@
+/**
+ * Replay captured serial output through pseudo-terminals
+ *
+ * Creates one pty per capture file and prints the slave device paths, one per
+ * line, so they can be handed to telemd in place of real boards. Once every slave
+ * has been opened by the reader, lines are written round-robin across files; the
+ * ptys are closed after the reader has consumed everything.
+ *
+ *   ttyreplay [-t timeout_ms] [-d line_delay_ms] capture1.txt capture2.txt ...
+ */
+#include <fcntl.h>
+#include <poll.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/ioctl.h>
+#include <termios.h>
+#include <time.h>
+#include <unistd.h>
+
+// Poll interval (ms) while waiting on the reader
+#define WAIT_STEP 10
+// Time (ms) the reader's input queue must stay empty before hanging up
+#define DRAIN_SETTLE 200
+
+typedef struct {
+  FILE * in;
+  int master;
+  /**
+   * Our own (never read) slave fd, used to see how much input is still pending
+   */
+  int watch;
+  char * slave;
+} replay_t;
+
+static void sleep_ms(long ms) {
+  struct timespec ts = { ms / 1000, (ms % 1000) * 1000000 };
+  nanosleep(&ts, NULL);
+}
+
+static int write_all(int fd, const char * buf, size_t len) {
+  while (len) {
+    const ssize_t n = write(fd, buf, len);
+    if (n < 0) return -1;
+    buf += n;
+    len -= n;
+  }
+  return 0;
+}
+
+static int pty_open(replay_t * r) {
+  r->master = posix_openpt(O_RDWR | O_NOCTTY);
+  if (r->master < 0 || grantpt(r->master) < 0 || unlockpt(r->master) < 0) {
+    perror("posix_openpt");
+    return -1;
+  }
+  // raw mode, so the line discipline neither echoes nor rewrites the replayed bytes
+  struct termios tio;
+  if (tcgetattr(r->master, &tio) == 0) {
+    cfmakeraw(&tio);
+    tcsetattr(r->master, TCSANOW, &tio);
+  }
+  r->slave = ptsname(r->master); // static buffer, reused by the next call
+  if (r->slave) r->slave = strdup(r->slave);
+  // opening and closing the slave once makes the master report POLLHUP until the reader opens it
+  const int fd = r->slave ? open(r->slave, O_RDONLY | O_NOCTTY) : -1;
+  if (fd < 0) {
+    perror("ptsname");
+    return -1;
+  }
+  close(fd);
+  r->watch = -1;
+  return 0;
+}
+
+static int slave_open_by_reader(const replay_t * r) {
+  struct pollfd pfd = { r->master, 0, 0 };
+  return poll(&pfd, 1, 0) >= 0 && !(pfd.revents & POLLHUP);
+}
+
+static int input_pending(const replay_t * r) {
+  int n = 0;
+  return ioctl(r->watch, FIONREAD, &n) == 0 && n > 0;
+}
+
+int main(int argc, char ** argv) {
+  long timeout = 10000, line_delay = 0;
+  int opt;
+  while ((opt = getopt(argc, argv, "t:d:h")) != -1) {
+    switch (opt) {
+      case 't': timeout = strtol(optarg, NULL, 0); break;
+      case 'd': line_delay = strtol(optarg, NULL, 0); break;
+      default:
+        fprintf(stderr, "usage: ttyreplay [-t timeout_ms] [-d line_delay_ms] CAPTURE...\n");
+        return opt == 'h' ? 0 : 2;
+    }
+  }
+  const int n = argc - optind;
+  if (n <= 0) {
+    fprintf(stderr, "usage: ttyreplay [-t timeout_ms] [-d line_delay_ms] CAPTURE...\n");
+    return 2;
+  }
+
+  replay_t * replays = (replay_t *) calloc(n, sizeof(replay_t));
+  for (int i = 0; i < n; ++i) {
+    replays[i].in = fopen(argv[optind + i], "r");
+    if (!replays[i].in) {
+      perror(argv[optind + i]);
+      return 1;
+    }
+    if (pty_open(&replays[i]) < 0) return 1;
+  }
+  for (int i = 0; i < n; ++i) printf("%s\n", replays[i].slave);
+  fflush(stdout);
+
+  // wait for the reader to open every slave
+  for (int i = 0; i < n; ++i) {
+    long waited = 0;
+    while (!slave_open_by_reader(&replays[i])) {
+      if (waited >= timeout) {
+        fprintf(stderr, "%s: not opened within %ldms\n", replays[i].slave, timeout);
+        return 1;
+      }
+      sleep_ms(WAIT_STEP);
+      waited += WAIT_STEP;
+    }
+    replays[i].watch = open(replays[i].slave, O_RDONLY | O_NOCTTY | O_NONBLOCK);
+  }
+
+  char line[512];
+  int active = n;
+  while (active) {
+    active = 0;
+    for (int i = 0; i < n; ++i) {
+      if (!replays[i].in) continue;
+      if (!fgets(line, sizeof(line), replays[i].in)) {
+        fclose(replays[i].in);
+        replays[i].in = NULL;
+        continue;
+      }
+      ++active;
+      size_t len = 0;
+      while (line[len]) ++len;
+      if (write_all(replays[i].master, line, len) < 0) {
+        perror("write");
+        return 1;
+      }
+    }
+    if (line_delay) sleep_ms(line_delay);
+  }
+
+  // let the reader drain before hanging up, which discards unread input. Written bytes reach
+  // the slave's input queue asynchronously, so it must stay empty for a while to count as drained
+  for (int i = 0; i < n; ++i) {
+    long waited = 0, quiet = 0;
+    while (replays[i].watch >= 0 && quiet < DRAIN_SETTLE && waited < timeout) {
+      quiet = input_pending(&replays[i]) ? 0 : quiet + WAIT_STEP;
+      sleep_ms(WAIT_STEP);
+      waited += WAIT_STEP;
+    }
+  }
+  for (int i = 0; i < n; ++i) {
+    close(replays[i].master);
+    if (replays[i].watch >= 0) close(replays[i].watch);
+    free(replays[i].slave);
+  }
+  free(replays);
+  return 0;
+}